@@ -11,7 +11,12 @@ from binaryninja.types import Symbol  # for symbol table parsing
 
 # rega header constants
 REGA_MAGIC = b"rg"
-REGA_HEADER_SIZE = 4  # 2 bytes magic, 2 bytes program_size
+REGA_HEADER_SIZE = 4  # v1: 2 bytes magic, 2 bytes program_size
+# v2: magic, u16 0, u16 version, u16 header size, u32 entry,
+# code/data/bss descriptors (u32 address, u32 size, u32 file offset),
+# u32 symbol table offset, u32 symbol count
+REGA_V2_HEADER = struct.Struct("<2sHHHI" + "III" * 3 + "II")
+REGA_SECTION_CODE = 0
 
 
 class REGAView(BinaryView):
@@ -24,6 +29,7 @@ class REGAView(BinaryView):
             "IRRE"
         ].standalone_platform  # use the registered irre architecture
         self.raw = data  # keep a reference to the raw data
+        self.entry_addr = 0
 
     @classmethod
     def is_valid_for_data(self, data) -> bool:
@@ -40,13 +46,12 @@ class REGAView(BinaryView):
                 return False
             program_size = struct.unpack("<H", program_size_bytes)[0]
 
-            # define segments/sections
-            # the rega format seems to be flat: header followed by code/data.
-            # map the program content (after the header) into memory.
-            # let's map it starting at address 0 for simplicity, unless the architecture implies otherwise.
-            # the entry point will be the start of this mapped region.
-            # the 'program_size' is the size *after* the header.
-            load_addr = 0x0000  # load address for the program code/data
+            # an empty v1 program marks a versioned header
+            if program_size == 0 and self.raw.length > REGA_HEADER_SIZE:
+                return self.init_v2()
+
+            # v1 is flat: header followed by code/data, loaded at 0 and entered at 0
+            load_addr = 0x0000
             file_offset = REGA_HEADER_SIZE
             length = program_size
 
@@ -69,93 +74,86 @@ class REGAView(BinaryView):
             )  # assume code/data mix
 
             # define the entry point - start of the code/data block
+            self.entry_addr = load_addr
             self.add_entry_point(load_addr)
 
-            # --- optional: symbol table parsing ---
-            # the rega.d file describes a symbol table, but it's unclear if it's
-            # part of the standard executable format or just for object files.
-            # if symbols are present *after* the main code/data block in the file,
-            # we could parse them here. this requires knowing the exact format
-            # described in rega.d: length_of_symbols_array (u32), then for each symbol:
-            # name (char[] -> requires length prefix?), offset (int32)
-            # assuming name is null-terminated for simplicity here, adjust if needed
-            symbol_table_offset = file_offset + length
-            try:
-                # read symbol count (assuming u32 little-endian)
-                count_bytes = self.raw.read(symbol_table_offset, 4)
-                if len(count_bytes) < 4:
-                    raise ValueError("not enough data for symbol count")
-                symbol_count = struct.unpack("<I", count_bytes)[0]
-                current_offset = symbol_table_offset + 4
-
-                print(
-                    f"rega: found {symbol_count} symbols at offset 0x{symbol_table_offset:x}"
-                )
-
-                for i in range(symbol_count):
-                    # read name (assuming null-terminated string)
-                    name_bytes = b""
-                    while True:
-                        char_byte = self.raw.read(current_offset, 1)
-                        if not char_byte or char_byte == b"\x00":
-                            current_offset += 1  # consume null terminator
-                            break
-                        name_bytes += char_byte
-                        current_offset += 1
-                        if len(name_bytes) > 256:  # sanity check length
-                            raise ValueError(
-                                f"symbol name too long at offset {current_offset}"
-                            )
-
-                    name = name_bytes.decode("utf-8", errors="replace")  # decode name
-
-                    # read symbol offset (int32 little-endian)
-                    sym_offset_bytes = self.raw.read(current_offset, 4)
-                    if len(sym_offset_bytes) < 4:
-                        raise ValueError(
-                            f"not enough data for symbol offset for '{name}'"
-                        )
-                    sym_offset = struct.unpack("<i", sym_offset_bytes)[
-                        0
-                    ]  # signed offset
-                    current_offset += 4
-
-                    # define symbol in binja (adjust address based on load_addr)
-                    # assume function symbol for now, could be data too
-                    sym_addr = load_addr + sym_offset
-                    print(f"  symbol '{name}' -> 0x{sym_addr:x} (offset {sym_offset})")
-                    self.define_auto_symbol(
-                        Symbol(SymbolType.FunctionSymbol, sym_addr, name)
-                    )
-
-            except Exception as sym_e:
-                # check if it's just end of file or a real parsing error
-                if len(self.raw.read(symbol_table_offset, 1)) == 0:
-                    pass  # no symbol table present, that's okay
-                else:
-                    # only print warning if we expected symbols but failed
-                    if "symbol_count" in locals() and symbol_count > 0:
-                        print(
-                            f"rega warning: failed during symbol table parsing: {sym_e}"
-                        )
-                    # else: it's likely just no symbol table present after code/data
-            # --- end optional symbol parsing ---
-
             return True
 
         except Exception as e:
             print(f"error loading rega file: {e}")
             return False
 
+    def init_v2(self) -> bool:
+        header = self.raw.read(0, REGA_V2_HEADER.size)
+        if len(header) < REGA_V2_HEADER.size:
+            print("rega error: truncated v2 header.")
+            return False
+        fields = REGA_V2_HEADER.unpack(header)
+        version, entry = fields[2], fields[4]
+        code, data, bss = fields[5:8], fields[8:11], fields[11:14]
+        symbols_offset, symbol_count = fields[14], fields[15]
+        if version != 2:
+            print(f"rega error: unsupported version {version}.")
+            return False
+
+        # code and data are mapped from the file, bss is zero-filled
+        for (name, (address, size, file_offset), flags, semantics) in [
+            (
+                ".text",
+                code,
+                SegmentFlag.SegmentReadable | SegmentFlag.SegmentExecutable,
+                SectionSemantics.ReadOnlyCodeSectionSemantics,
+            ),
+            (
+                ".data",
+                data,
+                SegmentFlag.SegmentReadable | SegmentFlag.SegmentWritable,
+                SectionSemantics.ReadWriteDataSectionSemantics,
+            ),
+            (
+                ".bss",
+                bss,
+                SegmentFlag.SegmentReadable | SegmentFlag.SegmentWritable,
+                SectionSemantics.ReadWriteDataSectionSemantics,
+            ),
+        ]:
+            if size == 0:
+                continue
+            data_length = 0 if name == ".bss" else size
+            self.add_auto_segment(address, size, file_offset, data_length, flags)
+            self.add_auto_section(name, address, size, semantics)
+
+        self.entry_addr = entry
+        self.add_entry_point(entry)
+
+        # optional symbol table: u32 address, u8 section, u16 name length, name
+        offset = symbols_offset
+        for _ in range(symbol_count if symbols_offset else 0):
+            entry_bytes = self.raw.read(offset, 7)
+            if len(entry_bytes) < 7:
+                print("rega warning: truncated symbol table.")
+                break
+            address, section, name_length = struct.unpack("<IBH", entry_bytes)
+            name = self.raw.read(offset + 7, name_length).decode(
+                "utf-8", errors="replace"
+            )
+            offset += 7 + name_length
+            symbol_type = (
+                SymbolType.FunctionSymbol
+                if section == REGA_SECTION_CODE
+                else SymbolType.DataSymbol
+            )
+            self.define_auto_symbol(Symbol(symbol_type, address, name))
+
+        return True
+
     def perform_is_executable(self) -> bool:
         # this file format contains executable code
         return True
 
     def perform_get_entry_point(self) -> int:
-        # entry point is defined in init() as the start of the mapped code segment
-        # typically the first entry point added is returned by default,
-        # but we can explicitly return the intended start address.
-        return 0x0000  # matches the load_addr used in init()
+        # v1 programs start at 0, v2 headers give the entry point
+        return self.entry_addr
 
     # optional: add perform_get_address_size if different from arch default
     def perform_get_address_size(self) -> int:
@@ -9,18 +9,34 @@ VBCC = "tools/vbcc"
 IRRE = "src/irretool"
 
 DEBUG = os.environ.get('DEBUG') != None
+# assembler output cache (see irretool asm --cache-dir); unchanged sources are not reassembled
+ASM_CACHE = os.environ.get('IRRE_ASM_CACHE', os.path.expanduser('~/.cache/irre/asm'))
 
 cmd_vbcc = sh.Command(f'{VBCC}/bin/vbccirre')
 cmd_irretool = sh.Command(f'{IRRE}/irretool')
 
 
+LIB_DIR = 'test/lib/'
+
+def is_up_to_date(output, inputs):
+    if not os.path.exists(output):
+        return False
+    output_mtime = os.path.getmtime(output)
+    return all(os.path.getmtime(f) <= output_mtime for f in inputs)
+
 def run_cc(c_file, output_base):
-    cc_file = cmd_vbcc.bake('-c99', '-default-main', f'-o={output_base}.ire', c_file,)
-    if DEBUG:
-        print(f' running {cc_file} (c -> ire)')
-    cc_file(_fg=DEBUG)
+    # the c compiler only reruns when the source or a shared header changed
+    headers = [os.path.join(LIB_DIR, f) for f in os.listdir(LIB_DIR)]
+    if is_up_to_date(f'{output_base}.ire', [c_file] + headers):
+        if DEBUG:
+            print(f' {output_base}.ire is up to date')
+    else:
+        cc_file = cmd_vbcc.bake('-c99', '-default-main', f'-o={output_base}.ire', c_file,)
+        if DEBUG:
+            print(f' running {cc_file} (c -> ire)')
+        cc_file(_fg=DEBUG)
 
-    asm_file = cmd_irretool.bake("asm", f'{output_base}.ire', f'{output_base}.bin')
+    asm_file = cmd_irretool.bake("asm", "--cache-dir", ASM_CACHE, f'{output_base}.ire', f'{output_base}.bin')
     if DEBUG:
         print(f' running {asm_file} (ire -> bin)')
     asm_file(_fg=DEBUG)
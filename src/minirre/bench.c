@@ -0,0 +1,243 @@
+#include "getopt.h"
+#include "irre.h"
+#include "rega.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// runs independent vms in parallel, one per thread, and reports the aggregate
+// instruction rate
+
+#define IRRE_BENCH_MEMORY_SIZE (1024 * 64) // 64 KB
+
+// the default workload: count r1 down from $007f0000, storing and loading
+// the counter and summing it into r0
+static const uint8_t BENCH_LOOP[] = {
+    'r',  'g',  44,   0,    // v1 header
+    0x0b, 0x01, 0x00, 0x00, // set r1 #0
+    0x41, 0x01, 0x7f, 0x00, // sup r1 #$7f
+    0x0b, 0x02, 0x01, 0x00, // set r2 #1
+    0x0b, 0x03, 0x14, 0x00, // set r3 #20
+    0x0b, 0x04, 0x00, 0x10, // set r4 #$1000
+    0x0e, 0x01, 0x04, 0x00, // stw r1 r4 #0
+    0x0d, 0x05, 0x04, 0x00, // ldw r5 r4 #0
+    0x01, 0x00, 0x00, 0x05, // add r0 r0 r5
+    0x02, 0x01, 0x01, 0x02, // sub r1 r1 r2
+    0x25, 0x03, 0x01, 0x00, // bvn r3 r1 #0
+    0xff, 0x00, 0x00, 0x00, // hlt
+};
+
+typedef struct {
+  IrreState state;
+  IRRE_UBYTE *memory; // owned by the instance
+  bool guarded;
+  IrreDecoded *decoded;
+  const uint8_t *binary;
+  size_t binary_size;
+  uint64_t max_steps;
+  uint64_t steps;
+  uint64_t errors;
+  bool loaded;
+} BenchInstance;
+
+static double now(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void handle_error(IrreState *state, void *context, IrreError err) {
+  (void)err;
+  BenchInstance *instance = context;
+  instance->errors++;
+  state->executing = false;
+}
+
+static IRRE_UWORD handle_device(IrreState *state, void *context,
+                                IRRE_UWORD device_id, IRRE_UWORD device_command,
+                                IRRE_UWORD device_data) {
+  (void)state;
+  (void)context;
+  (void)device_id;
+  (void)device_command;
+  (void)device_data;
+  return 0;
+}
+
+static void *run_instance(void *arg) {
+  BenchInstance *instance = arg;
+  irre_init(&instance->state, instance->memory, IRRE_BENCH_MEMORY_SIZE,
+            instance->decoded);
+  instance->state.error_handler = handle_error;
+  instance->state.device_handler = handle_device;
+  instance->state.context = instance;
+  instance->state.guarded = instance->guarded;
+  instance->loaded =
+      rega_load(&instance->state, instance->binary, instance->binary_size);
+  if (instance->loaded) {
+    instance->steps = irre_run(&instance->state, instance->max_steps);
+  }
+  return NULL;
+}
+
+/** run every instance once, in parallel; returns the aggregate rate, or a
+ * negative value on failure */
+static double run_pass(const char *name, int instance_count, bool guarded,
+                       const uint8_t *binary, size_t binary_size,
+                       uint64_t max_steps) {
+  BenchInstance *instances = calloc(instance_count, sizeof(BenchInstance));
+  pthread_t *threads = calloc(instance_count, sizeof(pthread_t));
+  if (!instances || !threads) {
+    printf("[%s] out of memory\n", __func__);
+    return -1;
+  }
+  for (int i = 0; i < instance_count; i++) {
+    BenchInstance *instance = &instances[i];
+#if IRRE_GUARDED_MEMORY
+    instance->memory = guarded ? irre_guarded_alloc(IRRE_BENCH_MEMORY_SIZE)
+                               : malloc(IRRE_BENCH_MEMORY_SIZE);
+#else
+    instance->memory = malloc(IRRE_BENCH_MEMORY_SIZE);
+#endif
+    instance->guarded = guarded;
+    instance->decoded = malloc(IRRE_DECODED_COUNT(IRRE_BENCH_MEMORY_SIZE) *
+                               sizeof(IrreDecoded));
+    if (!instance->memory || !instance->decoded) {
+      printf("[%s] out of memory\n", __func__);
+      return -1;
+    }
+    instance->binary = binary;
+    instance->binary_size = binary_size;
+    instance->max_steps = max_steps;
+  }
+
+  printf("[%s] %s: running %d instances\n", __func__, name, instance_count);
+  double start = now();
+  for (int i = 0; i < instance_count; i++) {
+    if (pthread_create(&threads[i], NULL, run_instance, &instances[i]) != 0) {
+      printf("[%s] could not start thread %d\n", __func__, i);
+      return -1;
+    }
+  }
+  for (int i = 0; i < instance_count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  double seconds = now() - start;
+
+  uint64_t total_steps = 0;
+  bool ok = true;
+  for (int i = 0; i < instance_count; i++) {
+    BenchInstance *instance = &instances[i];
+    if (!instance->loaded) {
+      printf("[%s] instance %d: not a valid binary\n", __func__, i);
+      ok = false;
+    } else {
+      printf("[%s] instance %d: %llu instructions, %llu errors, r0: $%08x\n",
+             __func__, i, (unsigned long long)instance->steps,
+             (unsigned long long)instance->errors, instance->state.r[REG_R0]);
+    }
+    total_steps += instance->steps;
+#if IRRE_GUARDED_MEMORY
+    if (guarded) {
+      irre_guarded_free(instance->memory);
+    } else {
+      free(instance->memory);
+    }
+#else
+    free(instance->memory);
+#endif
+    free(instance->decoded);
+  }
+  double rate = seconds > 0 ? total_steps / seconds / 1e6 : 0.0;
+  printf("[%s] %s: %llu instructions in %.3f s: %.1f M instructions/s\n",
+         __func__, name, (unsigned long long)total_steps, seconds, rate);
+
+  free(instances);
+  free(threads);
+  return ok ? rate : -1;
+}
+
+int main(int argc, char **argv) {
+  int instance_count = 4;
+  uint64_t max_steps = 0;
+  char *filename = NULL;
+  char *mode = "both";
+
+  int c;
+  while ((c = getopt(argc, argv, "n:s:f:m:")) != -1) {
+    switch (c) {
+    case 'n':
+      instance_count = atoi(optarg);
+      break;
+    case 's':
+      max_steps = strtoull(optarg, NULL, 10);
+      break;
+    case 'f':
+      filename = optarg;
+      break;
+    case 'm':
+      mode = optarg;
+      break;
+    default:
+      printf("usage: %s [-n <instances>] [-s <max steps>] [-f <filename>] "
+             "[-m checked|guarded|both]\n",
+             argv[0]);
+      return 1;
+    }
+  }
+  if (instance_count < 1) {
+    printf("[%s] need at least one instance\n", __func__);
+    return 1;
+  }
+  bool run_checked = strcmp(mode, "checked") == 0 || strcmp(mode, "both") == 0;
+  bool run_guarded = strcmp(mode, "guarded") == 0 || strcmp(mode, "both") == 0;
+  if (!run_checked && !run_guarded) {
+    printf("[%s] unknown mode: %s\n", __func__, mode);
+    return 1;
+  }
+#if !IRRE_GUARDED_MEMORY
+  if (run_guarded) {
+    printf("[%s] guarded memory is not available on this platform\n",
+           __func__);
+    run_guarded = false;
+    if (!run_checked) {
+      return 1;
+    }
+  }
+#endif
+
+  const uint8_t *binary = BENCH_LOOP;
+  size_t binary_size = sizeof(BENCH_LOOP);
+  uint8_t *file_data = NULL;
+  if (filename) {
+    file_data = rega_read_file(filename, &binary_size);
+    if (!file_data) {
+      printf("[%s] could not read file %s\n", __func__, filename);
+      return 1;
+    }
+    binary = file_data;
+  }
+
+  double checked_rate = 0;
+  double guarded_rate = 0;
+  int status = 0;
+  if (run_checked) {
+    checked_rate = run_pass("checked", instance_count, false, binary,
+                            binary_size, max_steps);
+    status |= checked_rate < 0;
+  }
+  if (run_guarded) {
+    guarded_rate = run_pass("guarded", instance_count, true, binary,
+                            binary_size, max_steps);
+    status |= guarded_rate < 0;
+  }
+  if (run_checked && run_guarded && checked_rate > 0 && guarded_rate > 0) {
+    printf("[%s] guarded/checked: %.2fx\n", __func__,
+           guarded_rate / checked_rate);
+  }
+
+  free(file_data);
+  return status;
+}
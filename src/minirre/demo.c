@@ -1,31 +1,33 @@
 #include "getopt.h"
 #include "irre.h"
+#include "rega.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 
 #define IRRE_DEMO_MEMORY_SIZE (1024 * 64) // 64 KB
-IrreState vm_state;
-IRRE_UBYTE vm_memory[IRRE_DEMO_MEMORY_SIZE];
 
 typedef enum {
   DEMO_DEVICE_PING = 0x00001000,
   DEMO_DEVICE_RANDOM = 0x00005005,
 } DemoDevice;
 
-uint8_t *read_file(char *filename, size_t *size);
-
-void handle_irre_interrupt(IRRE_UWORD code) {
+void handle_irre_interrupt(IrreState *state, void *context, IRRE_UWORD code) {
+  (void)state;
+  (void)context;
   printf("[%s] code: %d\n", __func__, code);
 }
 
-void handle_irre_error(IrreError err) {
-  vm_state.executing = false;
+void handle_irre_error(IrreState *state, void *context, IrreError err) {
+  (void)context;
+  state->executing = false;
   printf("[%s] error: $%02x\n", __func__, err);
 }
 
-IRRE_UWORD handle_irre_device(IRRE_UWORD device_id, IRRE_UWORD device_command,
+IRRE_UWORD handle_irre_device(IrreState *state, void *context,
+                              IRRE_UWORD device_id, IRRE_UWORD device_command,
                               IRRE_UWORD device_data) {
+  (void)context;
   printf("[%s] device message: (id=$%08x, command=$%08x, data=$%08x)\n",
          __func__, device_id, device_command, device_data);
 
@@ -40,10 +42,16 @@ IRRE_UWORD handle_irre_device(IRRE_UWORD device_id, IRRE_UWORD device_command,
     IRRE_UWORD random_count = device_data;
     printf("[%s] random(address=$%08x, count=%d)\n", __func__, random_address,
            random_count);
+    if (random_address > state->mem_size ||
+        random_count > state->mem_size - random_address) {
+      printf("[%s] random range is outside memory\n", __func__);
+      return 0;
+    }
     // fill the memory with random bytes
     for (IRRE_UWORD i = 0; i < random_count; i++) {
-      vm_state.m[random_address + i] = rand() % 256;
+      state->m[random_address + i] = rand() % 256;
     }
+    irre_memory_written(state, random_address, random_count);
     return 0;
   }
   default: {
@@ -92,36 +100,38 @@ int main(int argc, char **argv) {
 
   // load the binary
   size_t binary_size;
-  uint8_t *binary = read_file(filename, &binary_size);
+  uint8_t *binary = rega_read_file(filename, &binary_size);
   if (!binary) {
+    printf("[%s] could not read file %s\n", __func__, filename);
     return 1;
   }
 
-  // check the header
-  if (binary[0] != 'r' || binary[1] != 'g') {
-    printf("[%s] file %s is not a valid binary\n", __func__, filename);
-    return 1;
-  }
-
-  // extract the program
-  size_t program_size = binary[2] | binary[3] << 8;
-  uint8_t *program = binary + 4;
-
-  // create the vm
-  vm_state.m = vm_memory;
-  vm_state.mem_size = IRRE_DEMO_MEMORY_SIZE;
+  // create the vm; main owns its memory
+  static IRRE_UBYTE vm_memory[IRRE_DEMO_MEMORY_SIZE];
+  static IrreDecoded vm_decoded[IRRE_DECODED_COUNT(IRRE_DEMO_MEMORY_SIZE)];
+  IrreState vm_state;
   printf("[%s] initializing vm (memory size: %d)\n", __func__,
          IRRE_DEMO_MEMORY_SIZE);
+  irre_init(&vm_state, vm_memory, IRRE_DEMO_MEMORY_SIZE, vm_decoded);
   vm_state.interrupt_handler = handle_irre_interrupt;
   vm_state.error_handler = handle_irre_error;
   vm_state.device_handler = handle_irre_device;
-  irre_init(&vm_state);
 
-  printf("[%s] loading program (size: %zu)\n", __func__, program_size);
-  irre_load(&vm_state, program, program_size);
+  if (!rega_load(&vm_state, binary, binary_size)) {
+    printf("[%s] file %s is not a valid binary\n", __func__, filename);
+    return 1;
+  }
+  printf("[%s] loaded %s (entry: $%04x)\n", __func__, filename,
+         vm_state.r[REG_PC]);
 
   printf("[%s] executing\n", __func__);
 
+  if (!debug_insdump) {
+    // no per-step output: run predecoded
+    uint64_t steps = irre_run(&vm_state, 0);
+    printf("[%s] executed %llu instructions\n", __func__,
+           (unsigned long long)steps);
+  }
   for (size_t step = 0; vm_state.executing; step++) {
     if (debug_insdump) {
       // debug: show instruction
@@ -167,21 +177,3 @@ int main(int argc, char **argv) {
 
   return 0;
 }
-
-uint8_t *read_file(char *filename, size_t *size) {
-  FILE *f = fopen(filename, "rb");
-  if (!f) {
-    printf("[%s] could not open file %s\n", __func__, filename);
-    return NULL;
-  }
-
-  fseek(f, 0, SEEK_END);
-  *size = ftell(f);
-  fseek(f, 0, SEEK_SET);
-
-  uint8_t *program_data = malloc(*size);
-  fread(program_data, 1, *size, f);
-  fclose(f);
-
-  return program_data;
-}
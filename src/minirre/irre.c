@@ -1,23 +1,124 @@
+#if !defined(_DEFAULT_SOURCE)
+// mmap and sigaction for guarded memory
+#define _DEFAULT_SOURCE
+#endif
+
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "irre.h"
 
-void irre_init(IrreState *state) {
-  // initialize registers
-  memset(state->r, 0, sizeof(state->r));
+#if IRRE_GUARDED_MEMORY
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// register operands of an instruction
+#define IRRE_R1 0x1
+#define IRRE_R2 0x2
+#define IRRE_R3 0x4
+#define IRRE_R12 (IRRE_R1 | IRRE_R2)
+#define IRRE_R123 (IRRE_R1 | IRRE_R2 | IRRE_R3)
+
+// every opcode and its register operands, in the order of its handler
+#define IRRE_OPCODES(X)                                                        \
+  X(NOP, 0) X(ADD, IRRE_R123) X(SUB, IRRE_R123) X(AND, IRRE_R123)              \
+  X(ORR, IRRE_R123) X(XOR, IRRE_R123) X(NOT, IRRE_R12) X(LSH, IRRE_R123)       \
+  X(ASH, IRRE_R123) X(TCU, IRRE_R123) X(TCS, IRRE_R123) X(SET, IRRE_R1)        \
+  X(MOV, IRRE_R12) X(LDW, IRRE_R12) X(STW, IRRE_R12) X(LDB, IRRE_R12)          \
+  X(STB, IRRE_R12) X(JMI, 0) X(JMP, IRRE_R1) X(BVE, IRRE_R12)                  \
+  X(BVN, IRRE_R12) X(CAL, IRRE_R1) X(RET, 0) X(MUL, IRRE_R123)                 \
+  X(DIV, IRRE_R123) X(MOD, IRRE_R123) X(SIA, IRRE_R1) X(SUP, IRRE_R1)          \
+  X(SXT, IRRE_R12) X(SEQ, IRRE_R12) X(INT, 0) X(SND, IRRE_R123) X(HLT, 0)
+
+static const IRRE_UBYTE irre_register_operands[256] = {
+#define IRRE_REGISTER_OPERANDS(name, regs) [OP_##name] = regs,
+    IRRE_OPCODES(IRRE_REGISTER_OPERANDS)
+#undef IRRE_REGISTER_OPERANDS
+};
+
+/** whether every register operand of an instruction names a register */
+static bool irre_registers_valid(IRRE_OPCODE opcode, IRRE_ARG a1, IRRE_ARG a2,
+                                 IRRE_ARG a3) {
+  IRRE_UBYTE regs = irre_register_operands[opcode];
+  return !(((regs & IRRE_R1) && a1 >= IRRE_REGISTER_COUNT) ||
+           ((regs & IRRE_R2) && a2 >= IRRE_REGISTER_COUNT) ||
+           ((regs & IRRE_R3) && a3 >= IRRE_REGISTER_COUNT));
+}
+
+/** whether width bytes at an address are in memory (without wrapping) */
+static bool irre_in_bounds(const IrreState *state, IRRE_UWORD addr,
+                           IRRE_UWORD width) {
+  return addr < state->mem_size && state->mem_size - addr >= width;
+}
+
+/** memory words are little endian */
+static IRRE_UWORD irre_read_word(const IRRE_UBYTE *p) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  IRRE_UWORD word;
+  memcpy(&word, p, sizeof(word));
+  return word;
+#else
+  return p[0] | p[1] << 8 | p[2] << 16 | (IRRE_UWORD)p[3] << 24;
+#endif
+}
+
+static void irre_write_word(IRRE_UBYTE *p, IRRE_UWORD word) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  // one store, so a faulting store to guarded memory writes nothing
+  memcpy(p, &word, sizeof(word));
+#else
+  p[0] = word & 0xff;
+  p[1] = (word >> 8) & 0xff;
+  p[2] = (word >> 16) & 0xff;
+  p[3] = (word >> 24) & 0xff;
+#endif
+}
+
+void irre_init(IrreState *state, IRRE_UBYTE *memory, IRRE_UWORD mem_size,
+               IrreDecoded *decoded) {
+  // the state borrows its memory from the host
+  memset(state, 0, sizeof(*state));
+  state->m = memory;
+  state->mem_size = mem_size;
+  state->decoded = decoded;
+  state->decoded_count = decoded ? IRRE_DECODED_COUNT(mem_size) : 0;
   // initialize memory
   memset(state->m, 0, state->mem_size);
-  // initialize other fields
+  irre_predecode(state, 0, state->mem_size);
+  // handlers, their context and the registers start cleared
   state->executing = false;
 }
 
-void irre_load(IrreState *state, IRRE_UBYTE *program, IRRE_UWORD size) {
+void irre_load(IrreState *state, const IRRE_UBYTE *program,
+               IRRE_UWORD size) {
   // copy the program into memory
   memcpy(state->m, program, size);
+  irre_memory_written(state, 0, size);
+  irre_start(state, 0);
+}
+
+bool irre_load_section(IrreState *state, IRRE_UWORD address,
+                       const IRRE_UBYTE *data, IRRE_UWORD size) {
+  if (address > state->mem_size || size > state->mem_size - address) {
+    return false;
+  }
+  if (data) {
+    memcpy(state->m + address, data, size);
+  } else {
+    memset(state->m + address, 0, size);
+  }
+  irre_memory_written(state, address, size);
+  return true;
+}
+
+void irre_start(IrreState *state, IRRE_UWORD entry) {
   // set the program counter
-  state->r[REG_PC] = 0;
+  state->r[REG_PC] = entry;
   // set the link register
   state->r[REG_LR] = 0;
   // set the stack pointer
@@ -37,9 +138,11 @@ IrreInstruction irre_decode(IRRE_WORD word) {
 
 IRRE_WORD irre_fetch(IrreState *state) {
   IRRE_UWORD fetch_addr = state->r[REG_PC];
-  if (fetch_addr + IRRE_INSTRUCTION_SIZE >= state->mem_size) {
+  if (fetch_addr >= state->mem_size ||
+      state->mem_size - fetch_addr <= IRRE_INSTRUCTION_SIZE) {
     if (state->error_handler) {
-      state->error_handler(IRRE_ERR_INVALID_MEMORY_ACCESS);
+      state->error_handler(state, state->context,
+                           IRRE_ERR_INVALID_MEMORY_ACCESS);
     }
     return 0;
   }
@@ -62,6 +165,15 @@ void irre_step(IrreState *state) {
 
 void irre_execute(IrreState *state, IrreInstruction instruction) {
   bool branch = false;
+  if (!irre_registers_valid(instruction.opcode, instruction.a1, instruction.a2,
+                            instruction.a3)) {
+    state->executing = false;
+    if (state->error_handler) {
+      state->error_handler(state, state->context, IRRE_ERR_INVALID_REGISTER);
+    }
+    state->r[REG_PC] += IRRE_INSTRUCTION_SIZE;
+    return;
+  }
   switch (instruction.opcode) {
   case OP_NOP: {
     break;
@@ -146,38 +258,39 @@ void irre_execute(IrreState *state, IrreInstruction instruction) {
   case OP_LDW: {
     IRRE_UWORD addr = state->r[instruction.a2];
     IRRE_BYTE offset = instruction.a3;
-    if (addr + offset + 3 >= state->mem_size) {
+    if (!irre_in_bounds(state, addr + offset, 4)) {
       if (state->error_handler) {
-        state->error_handler(IRRE_ERR_INVALID_MEMORY_ACCESS);
+        state->error_handler(state, state->context,
+                             IRRE_ERR_INVALID_MEMORY_ACCESS);
       }
       break;
     }
     state->r[instruction.a1] =
-        state->m[addr + offset + 0] << 0 | state->m[addr + offset + 1] << 8 |
-        state->m[addr + offset + 2] << 16 | state->m[addr + offset + 3] << 24;
+        irre_read_word(state->m + (IRRE_UWORD)(addr + offset));
     break;
   }
   case OP_STW: {
     IRRE_UWORD addr = state->r[instruction.a2];
     IRRE_BYTE offset = instruction.a3;
-    if (addr + offset + 3 >= state->mem_size) {
+    if (!irre_in_bounds(state, addr + offset, 4)) {
       if (state->error_handler) {
-        state->error_handler(IRRE_ERR_INVALID_MEMORY_ACCESS);
+        state->error_handler(state, state->context,
+                             IRRE_ERR_INVALID_MEMORY_ACCESS);
       }
       break;
     }
-    state->m[addr + offset + 0] = (state->r[instruction.a1] >> 0) & 0xff;
-    state->m[addr + offset + 1] = (state->r[instruction.a1] >> 8) & 0xff;
-    state->m[addr + offset + 2] = (state->r[instruction.a1] >> 16) & 0xff;
-    state->m[addr + offset + 3] = (state->r[instruction.a1] >> 24) & 0xff;
+    irre_write_word(state->m + (IRRE_UWORD)(addr + offset),
+                    state->r[instruction.a1]);
+    irre_memory_written(state, addr + offset, 4);
     break;
   }
   case OP_LDB: {
     IRRE_UWORD addr = state->r[instruction.a2];
     IRRE_BYTE offset = instruction.a3;
-    if (addr + offset >= state->mem_size) {
+    if (!irre_in_bounds(state, addr + offset, 1)) {
       if (state->error_handler) {
-        state->error_handler(IRRE_ERR_INVALID_MEMORY_ACCESS);
+        state->error_handler(state, state->context,
+                             IRRE_ERR_INVALID_MEMORY_ACCESS);
       }
       break;
     }
@@ -187,13 +300,15 @@ void irre_execute(IrreState *state, IrreInstruction instruction) {
   case OP_STB: {
     IRRE_UWORD addr = state->r[instruction.a2];
     IRRE_BYTE offset = instruction.a3;
-    if (addr + offset >= state->mem_size) {
+    if (!irre_in_bounds(state, addr + offset, 1)) {
       if (state->error_handler) {
-        state->error_handler(IRRE_ERR_INVALID_MEMORY_ACCESS);
+        state->error_handler(state, state->context,
+                             IRRE_ERR_INVALID_MEMORY_ACCESS);
       }
       break;
     }
     state->m[addr + offset] = (IRRE_BYTE)(state->r[instruction.a1] & 0xff);
+    irre_memory_written(state, addr + offset, 1);
     break;
   }
   case OP_JMI: {
@@ -253,11 +368,23 @@ void irre_execute(IrreState *state, IrreInstruction instruction) {
     break;
   }
   case OP_DIV: {
+    if (state->r[instruction.a3] == 0) {
+      if (state->error_handler) {
+        state->error_handler(state, state->context, IRRE_ERR_DIVIDE_BY_ZERO);
+      }
+      break;
+    }
     state->r[instruction.a1] =
         state->r[instruction.a2] / state->r[instruction.a3];
     break;
   }
   case OP_MOD: {
+    if (state->r[instruction.a3] == 0) {
+      if (state->error_handler) {
+        state->error_handler(state, state->context, IRRE_ERR_DIVIDE_BY_ZERO);
+      }
+      break;
+    }
     state->r[instruction.a1] =
         state->r[instruction.a2] % state->r[instruction.a3];
     break;
@@ -299,7 +426,7 @@ void irre_execute(IrreState *state, IrreInstruction instruction) {
     IRRE_UWORD code = (IRRE_UWORD)(instruction.a1 | (instruction.a2 << 8) |
                                    (instruction.a3 << 16));
     if (state->interrupt_handler) {
-      state->interrupt_handler(code);
+      state->interrupt_handler(state, state->context, code);
     }
     break;
   }
@@ -309,7 +436,8 @@ void irre_execute(IrreState *state, IrreInstruction instruction) {
     IRRE_UWORD device_data = state->r[instruction.a3];
 
     if (state->device_handler) {
-      IRRE_UWORD ret = state->device_handler(device_id, device_command, device_data);
+      IRRE_UWORD ret = state->device_handler(state, state->context, device_id,
+                                             device_command, device_data);
       state->r[instruction.a3] = ret;
     }
     break;
@@ -322,7 +450,7 @@ void irre_execute(IrreState *state, IrreInstruction instruction) {
     // illegal opcode
     state->executing = false;
     if (state->error_handler) {
-      state->error_handler(IRRE_ERR_ILLEGAL_OPCODE);
+      state->error_handler(state, state->context, IRRE_ERR_ILLEGAL_OPCODE);
     }
     break;
   }
@@ -332,3 +460,339 @@ void irre_execute(IrreState *state, IrreInstruction instruction) {
     state->r[REG_PC] += IRRE_INSTRUCTION_SIZE;
   }
 }
+
+/* predecoded execution */
+
+// computed goto dispatch where the compiler supports it
+#if !defined(IRRE_COMPUTED_GOTO)
+#if defined(__GNUC__) || defined(__clang__)
+#define IRRE_COMPUTED_GOTO 1
+#else
+#define IRRE_COMPUTED_GOTO 0
+#endif
+#endif
+
+// handler indices; 0 is the handler of every illegal opcode
+typedef enum {
+  IRRE_H_ILLEGAL = 0,
+#define IRRE_HANDLER_INDEX(name, regs) IRRE_H_##name,
+  IRRE_OPCODES(IRRE_HANDLER_INDEX)
+#undef IRRE_HANDLER_INDEX
+  IRRE_H_INVALID_REGISTER,
+} IrreHandler;
+
+static const IRRE_UBYTE irre_handler_of[256] = {
+#define IRRE_HANDLER_OF(name, regs) [OP_##name] = IRRE_H_##name,
+    IRRE_OPCODES(IRRE_HANDLER_OF)
+#undef IRRE_HANDLER_OF
+};
+
+static IrreDecoded irre_predecode_word(const IRRE_UBYTE *word) {
+  IrreDecoded decoded;
+  decoded.handler = irre_handler_of[word[0]];
+  decoded.a1 = word[1];
+  decoded.a2 = word[2];
+  decoded.a3 = word[3];
+  // checked once here, so handlers index registers directly
+  if (!irre_registers_valid(word[0], word[1], word[2], word[3])) {
+    decoded.handler = IRRE_H_INVALID_REGISTER;
+  }
+  switch (word[0]) {
+  case OP_SET:
+  case OP_SUP:
+    decoded.imm = (IRRE_UWORD)(word[2] | (word[3] << 8));
+    break;
+  case OP_JMI:
+  case OP_INT:
+    decoded.imm = (IRRE_UWORD)(word[1] | (word[2] << 8) | (word[3] << 16));
+    break;
+  case OP_LDW:
+  case OP_STW:
+  case OP_LDB:
+  case OP_STB:
+  case OP_BVE:
+  case OP_BVN:
+    // signed offset or comparand
+    decoded.imm = (IRRE_UWORD)(IRRE_WORD)(IRRE_BYTE)word[3];
+    break;
+  case OP_SIA: {
+    // the value to add, or nothing if the shift is out of range
+    IRRE_BYTE val = (IRRE_BYTE)word[2];
+    IRRE_BYTE shift = (IRRE_BYTE)word[3];
+    decoded.imm =
+        shift >= 0 && shift < 32 ? (IRRE_UWORD)(IRRE_WORD)val << shift : 0;
+    break;
+  }
+  default:
+    decoded.imm = word[3];
+    break;
+  }
+  return decoded;
+}
+
+void irre_predecode(IrreState *state, IRRE_UWORD address, IRRE_UWORD size) {
+  if (!state->decoded || size == 0) {
+    return;
+  }
+  IRRE_UWORD count = state->decoded_count;
+  if (count > IRRE_DECODED_COUNT(state->mem_size)) {
+    count = IRRE_DECODED_COUNT(state->mem_size);
+  }
+  // every word the range overlaps
+  uint64_t first = address / IRRE_INSTRUCTION_SIZE;
+  uint64_t last = ((uint64_t)address + size + IRRE_INSTRUCTION_SIZE - 1) /
+                  IRRE_INSTRUCTION_SIZE;
+  if (last > count) {
+    last = count;
+  }
+  for (uint64_t i = first; i < last; i++) {
+    state->decoded[i] =
+        irre_predecode_word(state->m + i * IRRE_INSTRUCTION_SIZE);
+  }
+}
+
+static uint64_t irre_snapshot_page_count(IRRE_UWORD mem_size) {
+  return ((uint64_t)mem_size + IRRE_SNAPSHOT_PAGE_SIZE - 1) >>
+         IRRE_SNAPSHOT_PAGE_SHIFT;
+}
+
+void irre_memory_written(IrreState *state, IRRE_UWORD address,
+                         IRRE_UWORD size) {
+  irre_predecode(state, address, size);
+  IrreSnapshot *snapshot = state->snapshot;
+  if (!snapshot || size == 0) {
+    return;
+  }
+  uint64_t page_count = irre_snapshot_page_count(snapshot->mem_size);
+  uint64_t first = address >> IRRE_SNAPSHOT_PAGE_SHIFT;
+  uint64_t last = ((uint64_t)address + size - 1) >> IRRE_SNAPSHOT_PAGE_SHIFT;
+  if (last >= page_count) {
+    last = page_count - 1;
+  }
+  for (uint64_t page = first; page <= last && page < page_count; page++) {
+    uint64_t bit = (uint64_t)1 << (page & 63);
+    if (!(snapshot->dirty_bits[page >> 6] & bit)) {
+      snapshot->dirty_bits[page >> 6] |= bit;
+      snapshot->dirty_pages[snapshot->dirty_count++] = (uint32_t)page;
+    }
+  }
+}
+
+// the run loop, with bounds checks
+#define IRRE_RUN_NAME irre_run_checked
+#define IRRE_RUN_GUARDED 0
+#include "irre_run.h"
+#undef IRRE_RUN_NAME
+#undef IRRE_RUN_GUARDED
+
+#if IRRE_GUARDED_MEMORY
+
+/* guarded memory */
+
+// the run loop for guarded memory: accesses are not checked, they fault
+#define IRRE_RUN_NAME irre_run_unchecked
+#define IRRE_RUN_GUARDED 1
+#include "irre_run.h"
+#undef IRRE_RUN_NAME
+#undef IRRE_RUN_GUARDED
+
+/** a guarded run in progress on this thread */
+typedef struct IrreGuardedRun {
+  IrreState *state;
+  sigjmp_buf resume;
+  volatile uint64_t fault_remaining; // the budget left at the faulting access
+  struct IrreGuardedRun *previous;
+} IrreGuardedRun;
+
+static _Thread_local IrreGuardedRun *irre_guarded_run;
+static struct sigaction irre_previous_segv;
+static struct sigaction irre_previous_bus;
+static pthread_once_t irre_fault_handler_once = PTHREAD_ONCE_INIT;
+
+/** the whole guest address space, and the 3 bytes a word access can reach
+ * past its end, rounded to pages */
+static size_t irre_guarded_reserve(void) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  return ((size_t)1 << 32) + page;
+}
+
+static void irre_guarded_fault(int sig, siginfo_t *info, void *ucontext) {
+  IrreGuardedRun *run = irre_guarded_run;
+  if (run) {
+    uintptr_t addr = (uintptr_t)info->si_addr;
+    uintptr_t base = (uintptr_t)run->state->m;
+    if (addr >= base && addr - base < irre_guarded_reserve()) {
+      siglongjmp(run->resume, 1);
+    }
+  }
+  // not a guest access: hand it to the handler installed before
+  struct sigaction *previous =
+      sig == SIGBUS ? &irre_previous_bus : &irre_previous_segv;
+  if (previous->sa_flags & SA_SIGINFO) {
+    previous->sa_sigaction(sig, info, ucontext);
+  } else if (previous->sa_handler != SIG_DFL &&
+             previous->sa_handler != SIG_IGN) {
+    previous->sa_handler(sig);
+  } else {
+    // fault again with the default action
+    signal(sig, SIG_DFL);
+  }
+}
+
+static void irre_install_fault_handler(void) {
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = irre_guarded_fault;
+  action.sa_flags = SA_SIGINFO | SA_NODEFER;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGSEGV, &action, &irre_previous_segv);
+  sigaction(SIGBUS, &action, &irre_previous_bus);
+}
+
+IRRE_UBYTE *irre_guarded_alloc(IRRE_UWORD mem_size) {
+  // memory has to end exactly at the guard, or accesses just past it would
+  // succeed here and fault on the checked path
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  if (mem_size % page != 0) {
+    return NULL;
+  }
+  size_t reserve = irre_guarded_reserve();
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+  flags |= MAP_NORESERVE;
+#endif
+  void *memory = mmap(NULL, reserve, PROT_NONE, flags, -1, 0);
+  if (memory == MAP_FAILED) {
+    return NULL;
+  }
+  if (mem_size > 0 &&
+      mprotect(memory, mem_size, PROT_READ | PROT_WRITE) != 0) {
+    munmap(memory, reserve);
+    return NULL;
+  }
+  pthread_once(&irre_fault_handler_once, irre_install_fault_handler);
+  return memory;
+}
+
+void irre_guarded_free(IRRE_UBYTE *memory) {
+  if (memory) {
+    munmap(memory, irre_guarded_reserve());
+  }
+}
+
+static uint64_t irre_run_guarded(IrreState *state, uint64_t budget) {
+  IrreGuardedRun run;
+  run.state = state;
+  run.previous = irre_guarded_run;
+  irre_guarded_run = &run;
+
+  volatile uint64_t remaining = budget;
+  if (sigsetjmp(run.resume, 1) != 0) {
+    // the instruction at pc faulted: report it the way the checked path does
+    remaining = run.fault_remaining;
+    if (state->error_handler) {
+      state->error_handler(state, state->context,
+                           IRRE_ERR_INVALID_MEMORY_ACCESS);
+    }
+    state->r[REG_PC] += IRRE_INSTRUCTION_SIZE;
+  }
+  if (state->executing && remaining > 0) {
+    remaining -= irre_run_unchecked(state, remaining, &run.fault_remaining);
+  }
+
+  irre_guarded_run = run.previous;
+  return budget - remaining;
+}
+
+#endif // IRRE_GUARDED_MEMORY
+
+uint64_t irre_run(IrreState *state, uint64_t max_steps) {
+  if (!state->executing) {
+    return 0;
+  }
+  uint64_t budget = max_steps ? max_steps : UINT64_MAX;
+#if IRRE_GUARDED_MEMORY
+  if (state->guarded && state->decoded) {
+    return irre_run_guarded(state, budget);
+  }
+#endif
+  return irre_run_checked(state, budget, NULL);
+}
+
+bool irre_run_to(IrreState *state, IRRE_UWORD pc, uint64_t max_steps) {
+  uint64_t remaining = max_steps ? max_steps : UINT64_MAX;
+  while (state->executing && state->r[REG_PC] != pc) {
+    if (remaining == 0) {
+      return false;
+    }
+    remaining--;
+    irre_step(state);
+  }
+  return state->executing;
+}
+
+/* snapshots */
+
+IrreSnapshot *irre_snapshot_take(IrreState *state) {
+  uint64_t page_count = irre_snapshot_page_count(state->mem_size);
+  IrreSnapshot *snapshot = calloc(1, sizeof(IrreSnapshot));
+  if (!snapshot) {
+    return NULL;
+  }
+  snapshot->memory = malloc(state->mem_size ? state->mem_size : 1);
+  snapshot->dirty_bits = calloc(page_count / 64 + 1, sizeof(uint64_t));
+  snapshot->dirty_pages = malloc((page_count + 1) * sizeof(uint32_t));
+  if (!snapshot->memory || !snapshot->dirty_bits || !snapshot->dirty_pages) {
+    irre_snapshot_free(NULL, snapshot);
+    return NULL;
+  }
+
+  memcpy(snapshot->r, state->r, sizeof(state->r));
+  snapshot->executing = state->executing;
+  snapshot->mem_size = state->mem_size;
+  memcpy(snapshot->memory, state->m, state->mem_size);
+  // a state tracks writes for its latest snapshot only
+  state->snapshot = snapshot;
+  return snapshot;
+}
+
+void irre_snapshot_restore(IrreState *state, IrreSnapshot *snapshot) {
+  if (state->snapshot != snapshot) {
+    // writes since this snapshot were not tracked: copy all of memory back
+    memcpy(state->m, snapshot->memory, snapshot->mem_size);
+    irre_predecode(state, 0, snapshot->mem_size);
+    memset(snapshot->dirty_bits, 0,
+           (irre_snapshot_page_count(snapshot->mem_size) / 64 + 1) *
+               sizeof(uint64_t));
+    snapshot->dirty_count = 0;
+  }
+  for (uint32_t i = 0; i < snapshot->dirty_count; i++) {
+    uint64_t start = (uint64_t)snapshot->dirty_pages[i]
+                     << IRRE_SNAPSHOT_PAGE_SHIFT;
+    uint64_t size = snapshot->mem_size - start;
+    if (size > IRRE_SNAPSHOT_PAGE_SIZE) {
+      size = IRRE_SNAPSHOT_PAGE_SIZE;
+    }
+    memcpy(state->m + start, snapshot->memory + start, size);
+    irre_predecode(state, (IRRE_UWORD)start, (IRRE_UWORD)size);
+    snapshot->dirty_bits[snapshot->dirty_pages[i] >> 6] = 0;
+  }
+  snapshot->dirty_count = 0;
+
+  memcpy(state->r, snapshot->r, sizeof(state->r));
+  state->executing = snapshot->executing;
+  state->snapshot = snapshot;
+}
+
+void irre_snapshot_free(IrreState *state, IrreSnapshot *snapshot) {
+  if (!snapshot) {
+    return;
+  }
+  if (state && state->snapshot == snapshot) {
+    state->snapshot = NULL;
+  }
+  free(snapshot->memory);
+  free(snapshot->dirty_bits);
+  free(snapshot->dirty_pages);
+  free(snapshot);
+}
@@ -7,6 +7,17 @@
 
 #define IRRE_INSTRUCTION_SIZE 4
 
+// guarded memory needs mmap, signals and a 64-bit little endian host
+#if !defined(IRRE_GUARDED_MEMORY)
+#if (defined(__unix__) || defined(__APPLE__)) &&                               \
+    (defined(__GNUC__) || defined(__clang__)) && UINTPTR_MAX > 0xffffffffu &&  \
+    defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define IRRE_GUARDED_MEMORY 1
+#else
+#define IRRE_GUARDED_MEMORY 0
+#endif
+#endif
+
 #define IRRE_BYTE int8_t
 #define IRRE_UBYTE uint8_t
 #define IRRE_WORD int32_t
@@ -101,27 +112,73 @@ typedef struct {
   IRRE_ARG a1, a2, a3;
 } IrreInstruction;
 
+/** an instruction predecoded for irre_run: the index of its handler, its
+ * operands, and its immediate or offset already assembled */
+typedef struct {
+  IRRE_UBYTE handler;
+  IRRE_ARG a1, a2, a3;
+  IRRE_UWORD imm;
+} IrreDecoded;
+
+/** the number of predecoded instructions that cover a memory */
+#define IRRE_DECODED_COUNT(mem_size) ((mem_size) / IRRE_INSTRUCTION_SIZE)
+
 typedef enum {
   IRRE_ERR_UNKNOWN = 0x00,
   IRRE_ERR_ILLEGAL_OPCODE = 0x10,
   IRRE_ERR_INVALID_MEMORY_ACCESS = 0x20,
+  IRRE_ERR_INVALID_REGISTER = 0x30,
+  IRRE_ERR_DIVIDE_BY_ZERO = 0x40,
 } IrreError;
 
-typedef struct {
+typedef struct IrreState IrreState;
+typedef struct IrreSnapshot IrreSnapshot;
+
+/** callbacks get the state that raised them and its context pointer */
+typedef void (*IrreInterruptHandler)(IrreState *state, void *context,
+                                     IRRE_UWORD code);
+typedef void (*IrreErrorHandler)(IrreState *state, void *context,
+                                 IrreError error);
+typedef IRRE_UWORD (*IrreDeviceHandler)(IrreState *state, void *context,
+                                        IRRE_UWORD device_id,
+                                        IRRE_UWORD device_command,
+                                        IRRE_UWORD device_data);
+
+/** a vm. it holds no global state, so any number of states can run at once,
+ * each on its own thread. memory and the predecoded buffer are owned by the
+ * host, which keeps them alive as long as the state */
+struct IrreState {
   IRRE_UWORD r[IRRE_REGISTER_COUNT]; // registers
-  IRRE_UBYTE *m;                     // memory
-  IRRE_UWORD mem_size;              // memory size
-  void (*interrupt_handler)(IRRE_UWORD);
-  void (*error_handler)(IrreError);
-  IRRE_UWORD (*device_handler)(IRRE_UWORD, IRRE_UWORD, IRRE_UWORD);
+  IRRE_UBYTE *m;                     // memory (borrowed)
+  IRRE_UWORD mem_size;               // memory size
+  IrreDecoded *decoded;              // predecoded memory (borrowed, optional)
+  IRRE_UWORD decoded_count;          // predecoded instructions
+  IrreInterruptHandler interrupt_handler;
+  IrreErrorHandler error_handler;
+  IrreDeviceHandler device_handler;
+  void *context; // passed to every handler
+  bool guarded;  // memory is from irre_guarded_alloc
+  IrreSnapshot *snapshot; // records the pages written since it was taken
   bool executing;
-} IrreState;
+};
 
-/** initialize a new vm state */
-void irre_init(IrreState *state);
+/** initialize a new vm state over host memory, and optionally a predecoded
+ * buffer of IRRE_DECODED_COUNT(mem_size) entries for irre_run; clears the
+ * memory, the registers and the handlers */
+void irre_init(IrreState *state, IRRE_UBYTE *memory, IRRE_UWORD mem_size,
+               IrreDecoded *decoded);
 
 /** load a program into memory */
-void irre_load(IrreState *state, IRRE_UBYTE *program, IRRE_UWORD size);
+void irre_load(IrreState *state, const IRRE_UBYTE *program,
+               IRRE_UWORD size);
+
+/** copy a section into memory at an address (or zero-fill it if data is NULL);
+ * returns false if it does not fit */
+bool irre_load_section(IrreState *state, IRRE_UWORD address,
+                       const IRRE_UBYTE *data, IRRE_UWORD size);
+
+/** reset the registers and start executing at an entry point */
+void irre_start(IrreState *state, IRRE_UWORD entry);
 
 /** fetch the next instruction */
 IRRE_WORD irre_fetch(IrreState *state);
@@ -135,4 +192,70 @@ void irre_execute(IrreState *state, IrreInstruction instruction);
 /** execute a vm step */
 void irre_step(IrreState *state);
 
+/** decode the instructions overlapping a range of memory again */
+void irre_predecode(IrreState *state, IRRE_UWORD address, IRRE_UWORD size);
+
+/** note a write to a range of memory: decodes it again and marks its pages
+ * dirty in the snapshot. the vm does this for its own stores; hosts call it
+ * after writing to memory directly */
+void irre_memory_written(IrreState *state, IRRE_UWORD address,
+                         IRRE_UWORD size);
+
+/** execute until the vm halts or max_steps instructions ran (0: no limit);
+ * returns the number of instructions executed.
+ * with predecoded memory this runs without a fetch, decode or call per
+ * instruction; without it, it steps */
+uint64_t irre_run(IrreState *state, uint64_t max_steps);
+
+/** step until pc reaches an address, the vm halts or max_steps instructions
+ * ran (0: no limit); returns whether pc reached the address */
+bool irre_run_to(IrreState *state, IRRE_UWORD pc, uint64_t max_steps);
+
+/* snapshots */
+
+// snapshots track writes in pages of this size
+#define IRRE_SNAPSHOT_PAGE_SHIFT 10
+#define IRRE_SNAPSHOT_PAGE_SIZE (1u << IRRE_SNAPSHOT_PAGE_SHIFT)
+
+/** the registers and memory of a vm at one point, and the pages written
+ * since, so a restore copies back only those */
+struct IrreSnapshot {
+  IRRE_UWORD r[IRRE_REGISTER_COUNT];
+  bool executing;
+  IRRE_UWORD mem_size;
+  IRRE_UBYTE *memory;    // memory when taken
+  uint64_t *dirty_bits;  // a bit per page written since
+  uint32_t *dirty_pages; // the same pages, as a list
+  uint32_t dirty_count;
+};
+
+/** take a snapshot of a vm and start tracking its writes (the state keeps a
+ * pointer to it); NULL if out of memory.
+ * a state tracks writes for one snapshot at a time, the active one: the last
+ * taken or restored. writes are not tracked for any other snapshot */
+IrreSnapshot *irre_snapshot_take(IrreState *state);
+
+/** put a vm back the way it was when the snapshot was taken, and make it the
+ * active snapshot. for the active snapshot this copies only the pages written
+ * since, so it costs the same for any memory size; any other snapshot copies
+ * all of memory back */
+void irre_snapshot_restore(IrreState *state, IrreSnapshot *snapshot);
+
+/** stop tracking writes, and free a snapshot */
+void irre_snapshot_free(IrreState *state, IrreSnapshot *snapshot);
+
+#if IRRE_GUARDED_MEMORY
+/** allocate guarded memory: the whole 32-bit guest address space is reserved,
+ * and only the first mem_size bytes are accessible. mem_size must be a
+ * multiple of the host page size, so memory ends exactly at the guard.
+ * a state over it with guarded set lets irre_run skip bounds checks; accesses
+ * past memory fault, and the fault is reported as
+ * IRRE_ERR_INVALID_MEMORY_ACCESS. installs a SIGSEGV/SIGBUS handler that
+ * passes faults it does not own on to the previous one. NULL on failure */
+IRRE_UBYTE *irre_guarded_alloc(IRRE_UWORD mem_size);
+
+/** release memory from irre_guarded_alloc */
+void irre_guarded_free(IRRE_UBYTE *memory);
+#endif
+
 #endif // _IRRE_H_
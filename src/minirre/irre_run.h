@@ -0,0 +1,378 @@
+/* the predecoded run loop, included by irre.c once per memory backend.
+ * IRRE_RUN_NAME names the function; with IRRE_RUN_GUARDED set, memory
+ * accesses are not checked and rely on guarded memory to fault */
+
+#if IRRE_COMPUTED_GOTO
+// labels as values are an extension
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+static uint64_t IRRE_RUN_NAME(IrreState *state, uint64_t budget,
+                              volatile uint64_t *fault_remaining) {
+#if !IRRE_RUN_GUARDED
+  (void)fault_remaining;
+#endif
+  uint64_t remaining = budget;
+  IRRE_UWORD *r = state->r;
+  IRRE_UBYTE *m = state->m;
+  const IrreDecoded *decoded = state->decoded;
+  const IrreDecoded *ins;
+
+  // instructions at or past fast_end are fetched the way irre_step fetches
+  // them, and so are unaligned ones
+  IRRE_UWORD fast_end = 0;
+  if (decoded) {
+    IRRE_UWORD count = state->decoded_count;
+    if (count > IRRE_DECODED_COUNT(state->mem_size)) {
+      count = IRRE_DECODED_COUNT(state->mem_size);
+    }
+    fast_end = count * IRRE_INSTRUCTION_SIZE;
+    if (fast_end + IRRE_INSTRUCTION_SIZE > state->mem_size) {
+      fast_end = state->mem_size > IRRE_INSTRUCTION_SIZE
+                     ? state->mem_size - IRRE_INSTRUCTION_SIZE
+                     : 0;
+    }
+  }
+
+#define IRRE_FETCH()                                                           \
+  do {                                                                         \
+    if (remaining == 0) {                                                      \
+      goto done;                                                               \
+    }                                                                          \
+    remaining--;                                                               \
+    IRRE_UWORD pc = r[REG_PC];                                                 \
+    if (pc >= fast_end || (pc & (IRRE_INSTRUCTION_SIZE - 1))) {                \
+      goto slow;                                                               \
+    }                                                                          \
+    ins = &decoded[pc / IRRE_INSTRUCTION_SIZE];                                \
+  } while (0)
+
+#if IRRE_COMPUTED_GOTO
+  static const void *const handlers[] = {
+      &&handler_ILLEGAL,
+#define IRRE_HANDLER_LABEL(name, regs) &&handler_##name,
+      IRRE_OPCODES(IRRE_HANDLER_LABEL)
+#undef IRRE_HANDLER_LABEL
+      &&handler_INVALID_REGISTER,
+  };
+#define IRRE_HANDLER(name) handler_##name:
+  // every handler dispatches the next instruction itself
+#define IRRE_NEXT()                                                            \
+  do {                                                                         \
+    IRRE_FETCH();                                                              \
+    goto *handlers[ins->handler];                                              \
+  } while (0)
+#else
+#define IRRE_HANDLER(name) case IRRE_H_##name:
+#define IRRE_NEXT() goto next
+#endif
+
+  // after a handler that can stop the vm
+#define IRRE_CHECKED_NEXT()                                                    \
+  do {                                                                         \
+    if (!state->executing) {                                                   \
+      goto done;                                                               \
+    }                                                                          \
+    IRRE_NEXT();                                                               \
+  } while (0)
+
+#define IRRE_ADVANCE() r[REG_PC] += IRRE_INSTRUCTION_SIZE
+
+#if IRRE_RUN_GUARDED
+  // nothing is checked: an access past memory faults, and the fault handler
+  // resumes after the instruction with the budget recorded here. the barrier
+  // keeps every earlier write ahead of the access
+#define IRRE_ACCESS(addr, width)                                               \
+  do {                                                                         \
+    *fault_remaining = remaining;                                              \
+    __asm__ __volatile__("" ::: "memory");                                     \
+  } while (0)
+#else
+#define IRRE_ACCESS(addr, width)                                               \
+  do {                                                                         \
+    if (!irre_in_bounds(state, addr, width)) {                                 \
+      IRRE_MEMORY_ERROR();                                                     \
+    }                                                                          \
+  } while (0)
+#endif
+
+#define IRRE_MEMORY_ERROR()                                                    \
+  do {                                                                         \
+    if (state->error_handler) {                                                \
+      state->error_handler(state, state->context,                              \
+                           IRRE_ERR_INVALID_MEMORY_ACCESS);                    \
+    }                                                                          \
+    IRRE_ADVANCE();                                                            \
+    IRRE_CHECKED_NEXT();                                                       \
+  } while (0)
+
+// a zero divisor leaves the destination as it was, like a bad access
+#define IRRE_DIVIDE_ERROR()                                                    \
+  do {                                                                         \
+    if (state->error_handler) {                                                \
+      state->error_handler(state, state->context, IRRE_ERR_DIVIDE_BY_ZERO);    \
+    }                                                                          \
+    IRRE_ADVANCE();                                                            \
+    IRRE_CHECKED_NEXT();                                                       \
+  } while (0)
+
+#if IRRE_COMPUTED_GOTO
+  IRRE_NEXT();
+#else
+next:
+  IRRE_FETCH();
+  switch (ins->handler)
+#endif
+  {
+    IRRE_HANDLER(NOP) {
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(ADD) {
+      r[ins->a1] = r[ins->a2] + r[ins->a3];
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(SUB) {
+      r[ins->a1] = r[ins->a2] - r[ins->a3];
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(AND) {
+      r[ins->a1] = r[ins->a2] & r[ins->a3];
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(ORR) {
+      r[ins->a1] = r[ins->a2] | r[ins->a3];
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(XOR) {
+      r[ins->a1] = r[ins->a2] ^ r[ins->a3];
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(NOT) {
+      r[ins->a1] = ~r[ins->a2];
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(LSH) {
+      IRRE_WORD shift = r[ins->a3];
+      if (shift >= 0) {
+        r[ins->a1] = r[ins->a2] << shift;
+      } else {
+        r[ins->a1] = r[ins->a2] >> -shift;
+      }
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(ASH) {
+      IRRE_WORD shift = r[ins->a3];
+      if (shift >= 0) {
+        r[ins->a1] = (IRRE_WORD)r[ins->a2] << shift;
+      } else {
+        r[ins->a1] = (IRRE_WORD)r[ins->a2] >> -shift;
+      }
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(TCU) {
+      IRRE_UWORD a = r[ins->a2];
+      IRRE_UWORD b = r[ins->a3];
+      r[ins->a1] = (IRRE_UWORD)(a > b ? 1 : a < b ? -1 : 0);
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(TCS) {
+      IRRE_WORD a = (IRRE_WORD)r[ins->a2];
+      IRRE_WORD b = (IRRE_WORD)r[ins->a3];
+      r[ins->a1] = (IRRE_UWORD)(a > b ? 1 : a < b ? -1 : 0);
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(SET) {
+      r[ins->a1] = ins->imm;
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(MOV) {
+      r[ins->a1] = r[ins->a2];
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(LDW) {
+      IRRE_UWORD addr = r[ins->a2] + ins->imm;
+      IRRE_ACCESS(addr, 4);
+      r[ins->a1] = irre_read_word(m + addr);
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(STW) {
+      IRRE_UWORD addr = r[ins->a2] + ins->imm;
+      IRRE_ACCESS(addr, 4);
+      irre_write_word(m + addr, r[ins->a1]);
+      // the store may have overwritten code
+      irre_memory_written(state, addr, 4);
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(LDB) {
+      IRRE_UWORD addr = r[ins->a2] + ins->imm;
+      IRRE_ACCESS(addr, 1);
+      r[ins->a1] = m[addr];
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(STB) {
+      IRRE_UWORD addr = r[ins->a2] + ins->imm;
+      IRRE_ACCESS(addr, 1);
+      m[addr] = r[ins->a1] & 0xff;
+      irre_memory_written(state, addr, 1);
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(JMI) {
+      r[REG_PC] = ins->imm;
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(JMP) {
+      r[REG_PC] = r[ins->a1];
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(BVE) {
+      if ((IRRE_WORD)r[ins->a2] == (IRRE_WORD)ins->imm) {
+        r[REG_PC] = r[ins->a1];
+      } else {
+        IRRE_ADVANCE();
+      }
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(BVN) {
+      if ((IRRE_WORD)r[ins->a2] != (IRRE_WORD)ins->imm) {
+        r[REG_PC] = r[ins->a1];
+      } else {
+        IRRE_ADVANCE();
+      }
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(CAL) {
+      IRRE_UWORD addr = r[ins->a1];
+      r[REG_LR] = r[REG_PC] + IRRE_INSTRUCTION_SIZE;
+      r[REG_PC] = addr;
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(RET) {
+      IRRE_UWORD addr = r[REG_LR];
+      if (addr == 0) { // halt
+        state->executing = false;
+        IRRE_ADVANCE();
+        goto done;
+      }
+      r[REG_PC] = addr;
+      r[REG_LR] = 0;
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(MUL) {
+      r[ins->a1] = r[ins->a2] * r[ins->a3];
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(DIV) {
+      if (r[ins->a3] == 0) {
+        IRRE_DIVIDE_ERROR();
+      }
+      r[ins->a1] = r[ins->a2] / r[ins->a3];
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(MOD) {
+      if (r[ins->a3] == 0) {
+        IRRE_DIVIDE_ERROR();
+      }
+      r[ins->a1] = r[ins->a2] % r[ins->a3];
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(SIA) {
+      r[ins->a1] += ins->imm;
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(SUP) {
+      r[ins->a1] = (r[ins->a1] & 0x0000FFFF) | (ins->imm << 16);
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(SXT) {
+      r[ins->a1] = (IRRE_WORD)r[ins->a2];
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(SEQ) {
+      r[ins->a1] = r[ins->a2] == ins->imm ? 1 : 0;
+      IRRE_ADVANCE();
+      IRRE_NEXT();
+    }
+    IRRE_HANDLER(INT) {
+      if (state->interrupt_handler) {
+        state->interrupt_handler(state, state->context, ins->imm);
+      }
+      IRRE_ADVANCE();
+      IRRE_CHECKED_NEXT();
+    }
+    IRRE_HANDLER(SND) {
+      if (state->device_handler) {
+        IRRE_UWORD ret = state->device_handler(state, state->context, r[ins->a1],
+                                               r[ins->a2], r[ins->a3]);
+        r[ins->a3] = ret;
+      }
+      IRRE_ADVANCE();
+      IRRE_CHECKED_NEXT();
+    }
+    IRRE_HANDLER(HLT) {
+      state->executing = false;
+      IRRE_ADVANCE();
+      goto done;
+    }
+    IRRE_HANDLER(ILLEGAL) {
+      state->executing = false;
+      if (state->error_handler) {
+        state->error_handler(state, state->context, IRRE_ERR_ILLEGAL_OPCODE);
+      }
+      IRRE_ADVANCE();
+      goto done;
+    }
+    IRRE_HANDLER(INVALID_REGISTER) {
+      state->executing = false;
+      if (state->error_handler) {
+        state->error_handler(state, state->context, IRRE_ERR_INVALID_REGISTER);
+      }
+      IRRE_ADVANCE();
+      goto done;
+    }
+  }
+
+slow:
+  // outside predecoded memory: fetch, decode and execute one step
+  irre_step(state);
+  IRRE_CHECKED_NEXT();
+
+done:
+  return budget - remaining;
+
+#undef IRRE_FETCH
+#undef IRRE_HANDLER
+#undef IRRE_NEXT
+#undef IRRE_CHECKED_NEXT
+#undef IRRE_ADVANCE
+#undef IRRE_MEMORY_ERROR
+#undef IRRE_DIVIDE_ERROR
+#undef IRRE_ACCESS
+}
+
+#if IRRE_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "rega.h"
+
+#define REGA_V2_HEADER_SIZE 56
+
+static uint32_t read_u16(const uint8_t *p) { return p[0] | p[1] << 8; }
+
+static uint32_t read_u32(const uint8_t *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+bool rega_load(IrreState *state, const uint8_t *binary, size_t size) {
+  if (size < 4 || binary[0] != 'r' || binary[1] != 'g') {
+    return false;
+  }
+  size_t program_size = read_u16(binary + 2);
+  if (program_size > 0 || size == 4) {
+    // v1
+    if (4 + program_size > size || program_size > state->mem_size) {
+      return false;
+    }
+    irre_load(state, binary + 4, program_size);
+    return true;
+  }
+
+  // v2: version, header size, entry, then code, data and bss descriptors
+  // (address, size, file offset)
+  if (size < REGA_V2_HEADER_SIZE || read_u16(binary + 4) != 2) {
+    return false;
+  }
+  uint32_t entry = read_u32(binary + 8);
+  for (int i = 0; i < 3; i++) {
+    const uint8_t *desc = binary + 12 + i * 12;
+    uint32_t address = read_u32(desc);
+    uint32_t section_size = read_u32(desc + 4);
+    uint32_t file_offset = read_u32(desc + 8);
+    bool is_bss = i == 2;
+    if (!is_bss && (file_offset > size || section_size > size - file_offset)) {
+      return false;
+    }
+    // bss is zero-filled instead of read
+    if (!irre_load_section(state, address,
+                           is_bss ? NULL : binary + file_offset,
+                           section_size)) {
+      return false;
+    }
+  }
+  irre_start(state, entry);
+  return true;
+}
+
+uint8_t *rega_read_file(const char *filename, size_t *size) {
+  FILE *f = fopen(filename, "rb");
+  if (!f) {
+    return NULL;
+  }
+
+  fseek(f, 0, SEEK_END);
+  long length = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (length < 0) {
+    fclose(f);
+    return NULL;
+  }
+
+  uint8_t *data = malloc(length > 0 ? (size_t)length : 1);
+  if (data && fread(data, 1, (size_t)length, f) != (size_t)length) {
+    free(data);
+    data = NULL;
+  }
+  fclose(f);
+  *size = (size_t)length;
+  return data;
+}
@@ -0,0 +1,18 @@
+#ifndef _REGA_H_
+#define _REGA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "irre.h"
+
+/** load a REGA executable into a vm and start it at its entry point.
+ * v1 is a single block at address 0, v2 has code, data and bss sections;
+ * returns false if the binary is malformed or does not fit in memory */
+bool rega_load(IrreState *state, const uint8_t *binary, size_t size);
+
+/** read a whole file into a buffer the caller frees; NULL on failure */
+uint8_t *rega_read_file(const char *filename, size_t *size);
+
+#endif // _REGA_H_
@@ -0,0 +1,283 @@
+#if !defined(_DEFAULT_SOURCE)
+// fork, pipe and waitpid for the fork server
+#define _DEFAULT_SOURCE
+#endif
+
+#include "getopt.h"
+#include "irre.h"
+#include "rega.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// runs a program once per input, resetting it between runs from a snapshot
+// (or, with -F, from a forked copy of a process that holds it).
+// each input is written to guest memory at the input address as a word
+// holding its length, followed by its bytes
+
+#if defined(__unix__) || defined(__APPLE__)
+#define IRRE_SWEEP_FORK 1
+#include <sys/wait.h>
+#include <unistd.h>
+#else
+#define IRRE_SWEEP_FORK 0
+#endif
+
+#define IRRE_SWEEP_MEMORY_SIZE (1024 * 64) // 64 KB
+
+typedef struct {
+  char *name;
+  uint8_t *data;
+  size_t size;
+} SweepInput;
+
+/** what one run left behind */
+typedef struct {
+  uint64_t steps;
+  IRRE_UWORD r0;
+  IrreError error;
+  bool failed;
+} SweepResult;
+
+static double now(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void handle_error(IrreState *state, void *context, IrreError err) {
+  SweepResult *result = context;
+  result->error = err;
+  result->failed = true;
+  state->executing = false;
+}
+
+static bool write_input(IrreState *state, IRRE_UWORD address,
+                        const SweepInput *input) {
+  if (address > state->mem_size || state->mem_size - address < 4 ||
+      input->size > state->mem_size - address - 4) {
+    return false;
+  }
+  IRRE_UWORD length = (IRRE_UWORD)input->size;
+  IRRE_UBYTE *p = state->m + address;
+  p[0] = length & 0xff;
+  p[1] = (length >> 8) & 0xff;
+  p[2] = (length >> 16) & 0xff;
+  p[3] = (length >> 24) & 0xff;
+  memcpy(p + 4, input->data, input->size);
+  irre_memory_written(state, address, (IRRE_UWORD)input->size + 4);
+  return true;
+}
+
+/** run one input from the current state */
+static void run_input(IrreState *state, IRRE_UWORD address,
+                      const SweepInput *input, uint64_t max_steps,
+                      SweepResult *result) {
+  memset(result, 0, sizeof(*result));
+  if (!write_input(state, address, input)) {
+    result->failed = true;
+    result->error = IRRE_ERR_INVALID_MEMORY_ACCESS;
+    return;
+  }
+  state->context = result;
+  result->steps = irre_run(state, max_steps);
+  result->r0 = state->r[REG_R0];
+  state->context = NULL;
+}
+
+#if IRRE_SWEEP_FORK
+/** run one input in a forked copy of this process, which exits afterwards */
+static bool run_input_forked(IrreState *state, IRRE_UWORD address,
+                             const SweepInput *input, uint64_t max_steps,
+                             SweepResult *result) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return false;
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  if (pid == 0) {
+    // the child's writes vanish with it
+    close(fds[0]);
+    SweepResult child_result;
+    run_input(state, address, input, max_steps, &child_result);
+    ssize_t written = write(fds[1], &child_result, sizeof(child_result));
+    _exit(written == (ssize_t)sizeof(child_result) ? 0 : 1);
+  }
+  close(fds[1]);
+  ssize_t got = read(fds[0], result, sizeof(*result));
+  close(fds[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  return got == (ssize_t)sizeof(*result) && WIFEXITED(status) &&
+         WEXITSTATUS(status) == 0;
+}
+#endif
+
+int main(int argc, char **argv) {
+  char *filename = NULL;
+  IRRE_UWORD input_address = 0;
+  bool has_input_address = false;
+  IRRE_UWORD snapshot_pc = 0;
+  bool has_snapshot_pc = false;
+  uint64_t max_steps = 0;
+  int repeat = 1;
+  bool quiet = false;
+  bool fork_server = false;
+
+  int c;
+  while ((c = getopt(argc, argv, "f:a:p:s:n:qF")) != -1) {
+    switch (c) {
+    case 'f':
+      filename = optarg;
+      break;
+    case 'a':
+      input_address = (IRRE_UWORD)strtoul(optarg, NULL, 0);
+      has_input_address = true;
+      break;
+    case 'p':
+      snapshot_pc = (IRRE_UWORD)strtoul(optarg, NULL, 0);
+      has_snapshot_pc = true;
+      break;
+    case 's':
+      max_steps = strtoull(optarg, NULL, 10);
+      break;
+    case 'n':
+      repeat = atoi(optarg);
+      break;
+    case 'q':
+      quiet = true;
+      break;
+    case 'F':
+      fork_server = true;
+      break;
+    default:
+      printf("usage: %s -f <filename> -a <input address> [-p <snapshot pc>] "
+             "[-s <max steps>] [-n <repeat>] [-q] [-F] <input files...>\n",
+             argv[0]);
+      return 1;
+    }
+  }
+  if (!filename || !has_input_address) {
+    printf("specify a filename with -f and an input address with -a\n");
+    return 1;
+  }
+#if !IRRE_SWEEP_FORK
+  if (fork_server) {
+    printf("[%s] the fork server is not available on this platform\n",
+           __func__);
+    return 1;
+  }
+#endif
+
+  // read everything once
+  size_t binary_size;
+  uint8_t *binary = rega_read_file(filename, &binary_size);
+  if (!binary) {
+    printf("[%s] could not read file %s\n", __func__, filename);
+    return 1;
+  }
+  int input_count = argc - optind;
+  SweepInput *inputs = calloc(input_count > 0 ? input_count : 1,
+                              sizeof(SweepInput));
+  for (int i = 0; i < input_count; i++) {
+    inputs[i].name = argv[optind + i];
+    inputs[i].data = rega_read_file(inputs[i].name, &inputs[i].size);
+    if (!inputs[i].data) {
+      printf("[%s] could not read input %s\n", __func__, inputs[i].name);
+      return 1;
+    }
+  }
+
+  // load once, and run to the snapshot point
+  static IRRE_UBYTE vm_memory[IRRE_SWEEP_MEMORY_SIZE];
+  static IrreDecoded vm_decoded[IRRE_DECODED_COUNT(IRRE_SWEEP_MEMORY_SIZE)];
+  IrreState vm_state;
+  irre_init(&vm_state, vm_memory, IRRE_SWEEP_MEMORY_SIZE, vm_decoded);
+  vm_state.error_handler = handle_error;
+  if (!rega_load(&vm_state, binary, binary_size)) {
+    printf("[%s] file %s is not a valid binary\n", __func__, filename);
+    return 1;
+  }
+  if (has_snapshot_pc && !irre_run_to(&vm_state, snapshot_pc, max_steps)) {
+    printf("[%s] the program never reached $%04x\n", __func__, snapshot_pc);
+    return 1;
+  }
+  IrreSnapshot *snapshot = NULL;
+  if (!fork_server) {
+    snapshot = irre_snapshot_take(&vm_state);
+    if (!snapshot) {
+      printf("[%s] out of memory\n", __func__);
+      return 1;
+    }
+  }
+  printf("[%s] snapshot at $%04x, %d inputs, %s\n", __func__,
+         vm_state.r[REG_PC], input_count,
+         fork_server ? "fork server" : "snapshot reset");
+
+  uint64_t runs = 0;
+  uint64_t failures = 0;
+  double reset_time = 0;
+  double reset_max = 0;
+  double start = now();
+  for (int round = 0; round < repeat; round++) {
+    for (int i = 0; i < input_count; i++) {
+      SweepResult result;
+      double reset;
+#if IRRE_SWEEP_FORK
+      if (fork_server) {
+        double fork_start = now();
+        if (!run_input_forked(&vm_state, input_address, &inputs[i], max_steps,
+                              &result)) {
+          printf("[%s] %s: the forked run failed\n", __func__, inputs[i].name);
+          return 1;
+        }
+        // the fork and the wait (and the run) replace the reset
+        reset = now() - fork_start;
+      } else
+#endif
+      {
+        run_input(&vm_state, input_address, &inputs[i], max_steps, &result);
+        double restore_start = now();
+        irre_snapshot_restore(&vm_state, snapshot);
+        reset = now() - restore_start;
+      }
+      reset_time += reset;
+      if (reset > reset_max) {
+        reset_max = reset;
+      }
+      runs++;
+      failures += result.failed;
+      if (!quiet && round == 0) {
+        printf("[%s] %s: %llu instructions, r0: $%08x", __func__,
+               inputs[i].name, (unsigned long long)result.steps, result.r0);
+        if (result.failed) {
+          printf(", error: $%02x", result.error);
+        }
+        printf("\n");
+      }
+    }
+  }
+  double seconds = now() - start;
+
+  printf("[%s] %llu runs (%llu failed) in %.3f s: %.0f runs/s\n", __func__,
+         (unsigned long long)runs, (unsigned long long)failures, seconds,
+         seconds > 0 ? runs / seconds : 0.0);
+  if (runs > 0) {
+    printf("[%s] %s: %.2f us mean, %.2f us max\n", __func__,
+           fork_server ? "fork, run and wait" : "reset",
+           reset_time / runs * 1e6, reset_max * 1e6);
+  }
+
+  irre_snapshot_free(&vm_state, snapshot);
+  for (int i = 0; i < input_count; i++) {
+    free(inputs[i].data);
+  }
+  free(inputs);
+  free(binary);
+  return 0;
+}